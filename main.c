@@ -6,22 +6,14 @@
  * Author : Jean-Paul
  */ 
 
-#define F_CPU 1000000
+#define SLEEP_DEEP 1 // 1: power-down, woken by a pin-change on RXD (PD0). 0: IDLE, woken by USART RX
+#define F_CPU 8000000UL // full speed (CLKPR divider 1), see clk_set()
+#define CLK_SLOW_DIV 16 // CLKPR divider used while idle (500kHz)
 #define BAUD 4800
-#define BAUD_FREQ ((F_CPU/(BAUD*16UL))-1)
+#define BAUD_FREQ ((F_CPU/(BAUD*8UL))-1) // UBRR0 at full speed, double speed (U2X0) mode
+#define BAUD_FREQ_SLOW (((F_CPU/CLK_SLOW_DIV)/(BAUD*8UL))-1) // UBRR0 while idle
 #define RAND_MAX 0x7FFF
 
-#define LEDA PA1
-#define LEDB PA2
-#define LEDC PA3
-#define LEDD PA4
-
-#define out_low(port,pin) port &= ~(1<<pin)
-#define out_high(port,pin) port |= (1<<pin)
-
-#define set_in(port,pin) port &= ~(1<<pin)
-#define set_out(port,pin) port |= (1<<pin)
-
 #define KRED  "\x1B[31m"
 #define KGRN  "\x1B[32m"
 #define KYEL  "\x1B[33m"
@@ -29,20 +21,163 @@
 #define KNRM  "\x1B[0m"
 #define KPNK  "\x1B[35m"
 #define KSGRN  "\x1B[36m"
+#define KWHT  "\x1B[37m"
+#define KBRED  "\x1B[91m"
+
+/************************************************************************/
+/* The choices: one X(key, pin, button, color) row per symbol, 2 to 8 rows.
+ *	key is what the player types, pin the LED's bit on LED_PORT, button the
+ *	push button's bit on BTN_PORT (pressed = low) and color the terminal
+ *	color Simon shows the key in. All LEDs share LED_PORT so any set of them
+ *	is lit with one port write.
+ *	Pick a preset with the SIMON_CHOICES compiler symbol (2, 4, 6 or 8), or
+ *	define CHOICE_TABLE, LED_PORT and LED_DDR to describe another board.
+ */
+/************************************************************************/
+#ifndef CHOICE_TABLE
+#ifndef SIMON_CHOICES
+#define SIMON_CHOICES 4
+#endif
+#if SIMON_CHOICES == 2
+#define LED_PORT PORTA
+#define LED_DDR DDRA
+#define CHOICE_TABLE(X) \
+	X('A', PA1, PB0, KRED) \
+	X('D', PA2, PB1, KGRN)
+#elif SIMON_CHOICES == 4
+#define LED_PORT PORTA
+#define LED_DDR DDRA
+#define CHOICE_TABLE(X) \
+	X('W', PA1, PB0, KRED) \
+	X('D', PA2, PB1, KGRN) \
+	X('S', PA3, PB2, KBLU) \
+	X('A', PA4, PB3, KYEL)
+#elif SIMON_CHOICES == 6
+#define LED_PORT PORTA
+#define LED_DDR DDRA
+#define CHOICE_TABLE(X) \
+	X('Q', PA1, PB0, KRED) \
+	X('W', PA2, PB1, KGRN) \
+	X('E', PA3, PB2, KBLU) \
+	X('D', PA4, PB3, KYEL) \
+	X('S', PA5, PB4, KPNK) \
+	X('A', PA6, PB5, KSGRN)
+#elif SIMON_CHOICES == 8 // PA0 is the ADC seed pin, so 8 LEDs need all of PORTC (JTAG fuse off)
+#define LED_PORT PORTC
+#define LED_DDR DDRC
+#define CHOICE_TABLE(X) \
+	X('Q', PC0, PB0, KRED) \
+	X('W', PC1, PB1, KGRN) \
+	X('E', PC2, PB2, KBLU) \
+	X('D', PC3, PB3, KYEL) \
+	X('C', PC4, PB4, KPNK) \
+	X('X', PC5, PB5, KSGRN) \
+	X('Z', PC6, PB6, KWHT) \
+	X('A', PC7, PB7, KBRED)
+#else
+#error "SIMON_CHOICES must be 2, 4, 6 or 8"
+#endif
+#endif
+
+// Push buttons: the free PORTB pins, read through pin-change interrupts PCINT8..15
+#ifndef BTN_PORT
+#define BTN_PORT PORTB
+#define BTN_DDR DDRB
+#define BTN_PIN PINB
+#define BTN_PCMSK PCMSK1
+#define BTN_PCIE PCIE1
+#define BTN_vect PCINT1_vect
+#endif
+#define BTN_DEBOUNCE_MS 5 // a button must read the same for this long to count
+#define BTN_QUEUE 8 // presses buffered until the game reads them (power of 2)
+#define BTN_TIMER_FAST ((1<<CS01)|(1<<CS00)) // Timer0 at clk/64 on the fast clock
+#define BTN_TIMER_SLOW (1<<CS01) // Timer0 at clk/8 on the slow clock
+#define BTN_OCR_FAST ((F_CPU/64/1000)-1) // 1ms ticks on the fast clock
+#define BTN_OCR_SLOW (((F_CPU/CLK_SLOW_DIV)/8/1000)-1) // 1ms ticks on the slow clock
+
+#define CHOICE_ONE(key,pin,button,color) +1
+#define CHOICE_KEY(key,pin,button,color) key,
+#define CHOICE_MASK(key,pin,button,color) (1<<(pin)),
+#define CHOICE_BUTTON(key,pin,button,color) (1<<(button)),
+#define CHOICE_COLOR(key,pin,button,color) color,
+#define CHOICE_ALL(key,pin,button,color) |(1<<(pin))
+#define CHOICE_BTN_ALL(key,pin,button,color) |(1<<(button))
+
+#define NUM_CHOICES (0 CHOICE_TABLE(CHOICE_ONE))
+#define LED_ALL (0 CHOICE_TABLE(CHOICE_ALL)) // every choice's LED bit
+#define BTN_ALL (0 CHOICE_TABLE(CHOICE_BTN_ALL)) // every choice's button bit
+
+#if NUM_CHOICES < 2 || NUM_CHOICES > 8
+#error "CHOICE_TABLE must have 2 to 8 rows"
+#endif
+
+#define SIMON_MAX 30 // symbols Simon must say before the player wins
+#define HS_COUNT 5 // entries in the high-score table
+#define HS_SLOTS 8 // EEPROM copies of the table, rotated through for wear leveling
+
+// Binary protocol framing: SYNC, TYPE, LEN, PAYLOAD[LEN], CRC8(TYPE..PAYLOAD)
+#define BIN_SYNC 0xA5
+#define BIN_MAX_PAYLOAD SIMON_MAX
+
+// Binary frame types sent by the client (host -> device)
+#define BIN_CMD_START	0x01 // begin a new game
+#define BIN_CMD_ANSWER	0x02 // payload: the player's sequence as choice indices
+#define BIN_CMD_QUIT	0x03 // abandon the current game
+#define BIN_CMD_TEXT	0x04 // leave binary mode, return to the ANSI terminal
+#define BIN_CMD_SCORES	0x05 // request the high-score table
+#define BIN_CMD_SEQ		0x06 // request Simon's whole sequence (to recover after a lost frame, WAKE or RESUMED)
+
+// Binary frame types sent by Simon (device -> host)
+#define BIN_EVT_SEQ		0x81 // payload: round number, newest choice index
+#define BIN_EVT_SCORE	0x82 // payload: score
+#define BIN_EVT_STATE	0x83 // payload: one of the BIN_ST_* codes
+#define BIN_EVT_SCORES	0x84 // payload: the HS_COUNT high scores, best first
+#define BIN_EVT_FULLSEQ	0x85 // payload: every choice index of the current sequence (empty outside a game)
+
+// Payloads of BIN_EVT_STATE
+#define BIN_ST_READY	0x00
+#define BIN_ST_WON		0x01
+#define BIN_ST_LOST		0x02
+#define BIN_ST_QUIT		0x03
+#define BIN_ST_SLEEP	0x04
+#define BIN_ST_WAKE		0x05
+#define BIN_ST_BADFRAME	0x06
+#define BIN_ST_TEXT		0x07
+#define BIN_ST_RESUMED	0x08 // warm start after a watchdog or brown-out reset
+#define BIN_ST_BUSY		0x09 // START while a game is in progress
+
+#define SNAP_MAGIC 0x5A // marks a snapshot written by snap_save()
 
-#define NUM_CHOICES 4
+// Power reduction (PRR) masks: modules gated while asleep, and while awake (never used)
+#define PRR_SLEEP ((1<<PRTWI)|(1<<PRTIM2)|(1<<PRTIM0)|(1<<PRTIM1)|(1<<PRSPI)|(1<<PRUSART0)|(1<<PRADC))
+#define PRR_AWAKE ((1<<PRTWI)|(1<<PRTIM2)|(1<<PRTIM1)|(1<<PRSPI)) // Timer0 debounces the buttons
+
+// Clock speeds for clk_set()
+#define CLK_FAST 0
+#define CLK_SLOW 1
+
+// Results of game_check()
+#define GAME_MISS 0
+#define GAME_MATCH 1
+#define GAME_WON 2
 
 #include <util/delay.h>
 #include <avr/io.h>
 #include <avr/interrupt.h>
 #include <avr/sleep.h>
 #include <avr/wdt.h>
+#include <avr/eeprom.h>
 #include <util/delay.h>
+#include <util/crc16.h>
 #include <stdio.h>
 #include <string.h>
 #include <stdlib.h>
+#include <stddef.h>
 
 void uart_init();
+void uart_config(void);
+void uart_resync(void);
+void uart_drop_line(void);
 static void uart_tx(char);
 static char uart_rx();
 void scanUART(char*, int);
@@ -53,30 +188,61 @@ void my_wdt_reset(void);
 void nlPrint(char*);
 void sleepNow(void);
 void wakeNow(void);
-void led_on(char led);
-void led_on(char led);
+void led_show(unsigned char mask);
+void btn_init(void);
+void btn_timer_rate(void);
+void btn_flush(void);
+#ifdef BTN_SIM
+void btn_inject(unsigned char choice);
+#endif
+int input_rx(char* c);
+void clk_set(unsigned char speed);
+void delay_ms(int ms);
+void game_reset(void);
+int game_extend(void);
+int game_check(char* answer);
+void snap_save(void);
+int snap_restore(void);
+void hs_load(void);
+void hs_submit(int new_score);
+void hs_flush(void);
+void bin_tx(unsigned char type, unsigned char* payload, unsigned char len);
+void bin_state(unsigned char state);
+void bin_loop(void);
 
 int main();
 
+unsigned char mcusr_mirror __attribute__((section(".noinit"))); // MCUSR saved by wdt_first()
+
 volatile int wdt_counter;
 volatile int runonce;
 volatile int sleeping;
+volatile int rxwake; // set by the pin-change (RXD or a button) that ends a power-down sleep
+volatile int binmode; // 1 while the compact binary protocol replaces the text UI
+volatile unsigned char clk_speed = 0xFF; // CLK_FAST or CLK_SLOW, unknown until the first clk_set()
+volatile unsigned char uart_txbusy; // a char may still be shifting out of the UART
 
 char input[50]; // buffer of user input
 char output[65]; // buffer for response to user
 
-char simonsaid[30]; // the string of Simon's repeat-me chars
-char simonledseq[30];
-char simonled;
+char simonsaid[SIMON_MAX+1]; // the string of Simon's repeat-me chars
+char simonledseq[SIMON_MAX+1]; // Simon's choice indices (0 to NUM_CHOICES-1)
+char simonled; // the newest choice index
 char simonsays; // the newest char to be added to simonsaid
 volatile int simonat = -1; // current in simonsaid
 
 volatile int rnd;
 
-char A = 'W';
-char B = 'D';
-char C = 'S';
-char D = 'A';
+const char choice_keys[NUM_CHOICES] = { CHOICE_TABLE(CHOICE_KEY) };
+const unsigned char choice_masks[NUM_CHOICES] = { CHOICE_TABLE(CHOICE_MASK) };
+const unsigned char choice_buttons[NUM_CHOICES] = { CHOICE_TABLE(CHOICE_BUTTON) };
+const char* const choice_colors[NUM_CHOICES] = { CHOICE_TABLE(CHOICE_COLOR) };
+
+volatile unsigned char btn_raw; // last sampled buttons (1 = pressed)
+volatile unsigned char btn_state; // debounced buttons (1 = pressed)
+volatile unsigned char btn_quiet; // ms btn_raw has been unchanged
+volatile unsigned char btn_queue[BTN_QUEUE]; // pressed choice indices, oldest first
+volatile unsigned char btn_head, btn_tail; // btn_queue write and read positions
 
 volatile int quitting;
 volatile int ingame;
@@ -84,48 +250,182 @@ volatile int playerturn;
 
 volatile int score;
 
+// One copy of the high-score table, as stored in EEPROM
+typedef struct {
+	unsigned char gen; // generation, the newest valid slot is the current table
+	unsigned char scores[HS_COUNT]; // best first
+	unsigned char crc; // CRC-8 over gen and scores
+} hs_record;
+
+// Game state kept across watchdog and brown-out resets (not cleared at start-up)
+typedef struct {
+	unsigned char magic; // SNAP_MAGIC
+	char simonsaid[SIMON_MAX+1];
+	char simonledseq[SIMON_MAX+1];
+	signed char simonat;
+	unsigned char score;
+	unsigned char ingame;
+	unsigned char playerturn;
+	unsigned char binmode;
+	unsigned char crc; // CRC-8 over everything above
+} snapshot;
+
+snapshot snap __attribute__((section(".noinit")));
+
+hs_record EEMEM hs_eeprom[HS_SLOTS]; // ring of table copies (wear leveling)
+hs_record hs_cache; // SRAM copy, serves every read
+volatile hs_record hs_pending; // the copy being written by the EE_READY interrupt
+volatile unsigned char hs_slot; // EEPROM slot of the newest copy
+volatile unsigned char hs_wpos = sizeof(hs_record); // next byte of hs_pending to write (sizeof: idle)
+volatile unsigned char hs_dirty; // hs_cache changed while a write was in flight
+
 /************************************************************************/
-/* Turn a PORTA LED ON (pins specified as a,b,c,...)         */
+/* Light exactly the LEDs in mask (choice_masks bits), all others off.
+ *	One port write. No interrupt writes LED_PORT, so no cli()/sei() needed
+ */
 /************************************************************************/
-void led_on(char led){
-	cli();
-	switch(led){
-		case 'a' :
-			out_high(PORTA,LEDA);
-			break;
-		case 'b' :
-			out_high(PORTA,LEDB);
-			break;
-		case 'c' :
-			out_high(PORTA,LEDC);
-			break;
-		case 'd' :
-			out_high(PORTA,LEDD);
-			break;		
+void led_show(unsigned char mask){
+	LED_PORT = (LED_PORT & ~LED_ALL) | mask;
+}
+
+/************************************************************************/
+/* Push Buttons
+ *	A pin-change on any button starts Timer0 ticking every 1ms. The tick
+ *	samples the buttons and, once they have read the same for
+ *	BTN_DEBOUNCE_MS, queues each new press and stops the timer again.
+ *	scanUART reads the queue next to the UART (see input_rx).
+ */
+/************************************************************************/
+
+/************************************************************************/
+/* Inputs with pull-ups, pin-change interrupts on, Timer0 in CTC mode   */
+/************************************************************************/
+void btn_init(void){
+	BTN_DDR &= (unsigned char)~BTN_ALL; // buttons are inputs
+	BTN_PORT |= BTN_ALL; // with pull-ups (a pressed button pulls its pin low)
+	btn_raw = btn_state = 0; // the pins are still charging, the first Timer0 pass debounces them
+	TCCR0A = (1<<WGM01); // Timer0 Clear Timer on Compare (CTC) mode, stopped until a pin-change
+	TIMSK0 = (1<<OCIE0A); // Timer0 Compare Match A interrupt
+	BTN_PCMSK |= BTN_ALL;
+	PCICR |= (1<<BTN_PCIE); // Enable Pin-Change Interrupts on the button port
+}
+
+/************************************************************************/
+/* (Re)start Timer0 with a 1ms tick at the current clock speed          */
+/************************************************************************/
+void btn_timer_rate(void){
+	if(clk_speed == CLK_SLOW){
+		OCR0A = BTN_OCR_SLOW;
+		TCCR0B = BTN_TIMER_SLOW;
 	}
-	sei();
+	else{
+		OCR0A = BTN_OCR_FAST;
+		TCCR0B = BTN_TIMER_FAST;
+	}
+}
+
+/************************************************************************/
+/* Queue a press of choice (0 to NUM_CHOICES-1), dropped if the queue is full.
+ *	Called with interrupts disabled
+ */
+/************************************************************************/
+void btn_push(unsigned char choice){
+	unsigned char next = (btn_head+1) & (BTN_QUEUE-1);
+	if(next == btn_tail) return;
+	btn_queue[btn_head] = choice;
+	btn_head = next;
+}
+
+/************************************************************************/
+/* Drop every queued press                                              */
+/************************************************************************/
+void btn_flush(void){
+	unsigned char sreg = SREG;
+	cli();
+	btn_tail = btn_head;
+	SREG = sreg;
 }
 
+#ifdef BTN_SIM
 /************************************************************************/
-/*  Turn a PORTA LED OFF (pins specified as a,b,c,...)   */
+/* Feed a button press into the input stream without hardware, for a
+ * simulator or debugger (build with BTN_SIM). Call it while Simon waits
+ * for input: scanUART drops presses queued before its read starts.
+ * The press is handled exactly like a debounced one
+ */
 /************************************************************************/
-void led_off(char led){
+void btn_inject(unsigned char choice){
+	unsigned char sreg = SREG;
+	if(choice >= NUM_CHOICES) return;
 	cli();
-	switch(led){
-		case 'a' :
-			out_low(PORTA,LEDA);
-			break;
-		case 'b' :
-			out_low(PORTA,LEDB);
-			break;
-		case 'c' :
-			out_low(PORTA,LEDC);
-			break;
-		case 'd' :
-			out_low(PORTA,LEDD);
-			break;
+	btn_push(choice);
+	SREG = sreg;
+}
+#endif
+
+/************************************************************************/
+/* Interrupt on any button edge: wake from power-down, or start debouncing */
+/************************************************************************/
+ISR(BTN_vect){
+#if SLEEP_DEEP
+	if(sleeping == 1){ // the press only wakes us (Timer0 is gated while asleep)
+		rxwake = 1;
+		return;
+	}
+#else
+	if(sleeping == 1){ // IDLE: the pin-change already woke the CPU, end the sleep-cycle and keep the press
+		sleep_disable();
+		UCSR0B &= ~(1<<RXCIE0); // the UART no longer needs to wake us
+		sleeping = 0;
+	}
+#endif
+	if(TCCR0B == 0){
+		btn_quiet = 0;
+		TCNT0 = 0;
+		btn_timer_rate();
+	}
+}
+
+/************************************************************************/
+/* Interrupt every 1ms while the buttons are settling                   */
+/************************************************************************/
+ISR(TIMER0_COMPA_vect){
+	unsigned char now = ~BTN_PIN & BTN_ALL; // 1 = pressed
+	unsigned char pressed;
+	int i;
+	if(now != btn_raw){ // still bouncing
+		btn_raw = now;
+		btn_quiet = 0;
+		return;
+	}
+	if(++btn_quiet < BTN_DEBOUNCE_MS) return;
+	
+	pressed = now & ~btn_state; // releases are not events
+	btn_state = now;
+	for(i = 0; i < NUM_CHOICES; i++){
+		if(pressed & choice_buttons[i]) btn_push(i);
+	}
+	TCCR0B = 0; // stable: stop Timer0 until the next pin-change
+}
+
+/************************************************************************/
+/* Wait for the next input char: a UART byte, or a queued button press as
+ * its choice's key. Returns 1 for a button press, 0 for a UART byte
+ */
+/************************************************************************/
+int input_rx(char* c){
+	while(1){
+		if(UCSR0A & (1<<RXC0)){
+			*c = UDR0;
+			return 0;
+		}
+		if(btn_tail != btn_head){
+			*c = choice_keys[btn_queue[btn_tail]];
+			btn_tail = (btn_tail+1) & (BTN_QUEUE-1);
+			my_wdt_reset(); // a press is activity, long answers on the buttons must not hit the sleep timeout
+			return 1;
+		}
 	}
-	sei();
 }
 
 /************************************************************************/
@@ -146,6 +446,7 @@ void wdt_first(void) \
  */
 /************************************************************************/
 void wdt_first(void){
+	mcusr_mirror = MCUSR; // keep the reset cause for the warm-start check in main()
 	MCUSR = 0; // initialize SREG_I flag to 0 (clear stored state pre-reset)
 	wdt_disable(); // disable a potentially still running watch-dog-timer (prevents uncontrolled resets)
 }
@@ -163,20 +464,47 @@ void wdt_init() {
 }
 
 /************************************************************************/
-/* Enter Sleep mode. Enable UARTRx interrupt for wake function
+/* Enter Sleep mode.
+ *	SLEEP_DEEP: power-down with every module gated (PRR), a pin-change on RXD wakes us.
+ *	Otherwise: IDLE, the UARTRx interrupt wakes us.
  *	http://maxembedded.com/2013/09/the-usart-of-the-avr/
 */                                                                      
 /************************************************************************/
 void sleepNow(){
 	cli(); // Disable global interrupts (protect from interruption)
+#if SLEEP_DEEP
+	hs_flush(); // an EEPROM write would keep the clock running in power-down
+	clk_set(CLK_SLOW); // the CPU wakes (briefly, on WDT ticks) at the slow clock
+	if(uart_txbusy) while(! (UCSR0A & (1<<TXC0)) ); // let the last char out before gating the USART
+	uart_txbusy = 0;
+	
+	rxwake = 0;
+	PCMSK3 |= (1<<PCINT24); // Pin-Change Interrupt on RXD (PD0), the USART can't run in power-down
+	PCIFR = (1<<PCIF3); // clear a stale pin-change flag (written as 1)
+	PCICR |= (1<<PCIE3); // Enable Pin-Change Interrupts on PORTD
+	ACSR |= (1<<ACD); // switch off the analog comparator
+	PRR = PRR_SLEEP; // gate ADC, SPI, TWI, timers and the USART
+	
+	set_sleep_mode(SLEEP_MODE_PWR_DOWN); //Set sleep to POWER-DOWN (only the WDT and pin-changes run)
+	sleep_enable(); // enable sleep option
+	sleeping = 1; // set sleep flag
+	do{
+		sei(); // re-enable global interrupts (takes effect after sleep_cpu, no wake can be missed)
+		sleep_cpu(); // manually sleep the CPU using configured mode
+		cli();
+	}while(rxwake == 0); // WDT ticks wake us too, go back to sleep until RXD changes
+	wakeNow();
+#else
 	UCSR0B |= (1<<RXCIE0); // Enable Receive Complete Interrupt Enable (RXCIE) #0
 	//^ Result: CPU will fire an interrupt if SREG (global interrupt flag) is set to 1 and RXC in UCSRA is set
 	
+	clk_set(CLK_SLOW); // IDLE keeps the CPU clock running, so keep it slow
 	set_sleep_mode(SLEEP_MODE_IDLE); //Set sleep to IDLE power-save (allows UART interrupting)
 	sleep_enable(); // enable sleep option
 	sleeping = 1; // set sleep flag	
 	sei(); // re-enable global interrupts
 	sleep_cpu(); // manually sleep the CPU using configured mode
+#endif
 }
 
 /************************************************************************/
@@ -187,9 +515,23 @@ void sleepNow(){
 void wakeNow(){
 	cli(); // Disable global interrupts (protect from interruption)
 	sleep_disable(); // disable sleep option
+#if SLEEP_DEEP
+	PRR = PRR_AWAKE; // power the USART and ADC back up
+	uart_config(); // a gated USART must be re-initialized
+	uart_resync(); // the char that woke us was lost, drop whatever is left of it
+	if(binmode == 0){
+		uart_drop_line(); // the rest of the line typed to wake us is not an answer
+	}
+#else
 	UCSR0B &= ~(1<<RXCIE0); // Disable Receive Complete Interrupt (RXCIE) 
-	scanUART(input,50); // we do this to clear UART (Rx) of any garbage
-	_delay_ms(500); // just a pause
+	if(binmode == 1){
+		(void)UDR0; // drop the wake byte, the client resends its frame after BIN_ST_WAKE
+	}
+	else{
+		scanUART(input,50); // we do this to clear UART (Rx) of any garbage
+	}
+	delay_ms(500); // just a pause
+#endif
 	sei(); // re-enable global interrupts
 	main(); //resume main
 }
@@ -201,6 +543,16 @@ ISR(USART0_RX_vect){
 	wakeNow();
 	// wakeNow calls main, no code below the wakeNow call will be executed
 }
+
+/************************************************************************/
+/* Interrupt that will wake the device from power-down via a pin-change on RXD.
+ *	sleepNow() sees rxwake and calls wakeNow()
+ */
+/************************************************************************/
+ISR(PCINT3_vect){
+	PCICR &= ~(1<<PCIE3); // one wake is enough, the USART takes over from here
+	rxwake = 1;
+}
 	
 /************************************************************************/
 /*  Interrupt code called each second (1s) by the WDT
@@ -214,15 +566,16 @@ ISR(WDT_vect){
 		wdt_reset(); // restart the WDT at zero (in interrupt-only mode)
 		// Note: wdt_reset restarts the timer, which ticks by milliseconds up to ~1s (in this implementation)
 		// We use the counter to count ticks up to 30 (a minute)
-		if(wdt_counter == 15 && sleeping == 0){
+		if(wdt_counter == 15 && sleeping == 0 && binmode == 0){
 			nlPrint("-- Note: No input received for 15s. SleepMode in t-minus 15s --");
 		}
 	}
 	else { // Reset the WDT on the 30th tick (equal to ~1min if timeout is ~1 sec)
 		my_wdt_reset();
 		if(sleeping == 0) {
-			nlPrint("Sleep mode activated. Hit enter to wake.");
-			_delay_ms(1000);
+			if(binmode == 1) bin_state(BIN_ST_SLEEP);
+			else nlPrint("Sleep mode activated. Hit enter to wake.");
+			delay_ms(1000);
 			sleepNow();
 		}			
 	}
@@ -278,6 +631,50 @@ int my_rand(void){
 	return temp;
 }
 
+/************************************************************************/
+/* Switch the system clock prescaler (CLKPR) between CLK_FAST (F_CPU) and
+ * CLK_SLOW (F_CPU/CLK_SLOW_DIV), and reprogram UBRR0 to keep 4800 baud.
+ *	CPU-bound work (seeding and drawing Simon's next symbol) runs fast.
+ *	Everything else runs slow: waiting for input, delays and printing, which
+ *	spends its time waiting on the 4800 baud line rather than computing.
+ *	The WDT runs from its own 128kHz oscillator and is not affected.
+ */
+/************************************************************************/
+void clk_set(unsigned char speed){
+	unsigned char sreg, div;
+	unsigned int ubrr;
+	if(clk_speed == speed) return;
+	div = (speed == CLK_SLOW) ? (1<<CLKPS2) : 0; // divide by 16 or 1
+	ubrr = (speed == CLK_SLOW) ? BAUD_FREQ_SLOW : BAUD_FREQ;
+	
+	sreg = SREG;
+	cli(); // no interrupt may start a char between the drain and the switch
+	if(uart_txbusy){ // a char still in the shift register would be garbled by the baud change
+		while(! (UCSR0A & (1<<TXC0)) );
+		uart_txbusy = 0;
+	}
+	// CLKPS must be written within 4 cycles of CLKPCE
+	CLKPR = (1<<CLKPCE); // Enable the Clock Prescaler Change bit
+	CLKPR = div;
+	UBRR0H = (ubrr>>8);
+	UBRR0L = ubrr;
+	clk_speed = speed;
+	if(TCCR0B != 0) btn_timer_rate(); // keep a running debounce tick at 1ms
+	SREG = sreg; // restore the interrupt flag (may be called with interrupts off)
+}
+
+/************************************************************************/
+/* Wait ms milliseconds at the slow clock (the speed is restored afterwards).
+ *	_delay_us assumes F_CPU, the slow clock stretches each loop CLK_SLOW_DIV times.
+ */
+/************************************************************************/
+void delay_ms(int ms){
+	unsigned char speed = clk_speed;
+	clk_set(CLK_SLOW);
+	while(ms-- > 0) _delay_us(1000.0/CLK_SLOW_DIV);
+	clk_set(speed);
+}
+
 /************************************************************************/
 /* 
  * Initialize UART and printf magic
@@ -289,15 +686,68 @@ void uart_init(){
 	//These are the 2 lines of "magic" to enable stdio functions to work over UART
 	static FILE uart_stream = FDEV_SETUP_STREAM(uart_tx, uart_rx, _FDEV_SETUP_RW );
 	stdout = stdin = &uart_stream;
+	uart_config();
+	sei();
+}
 
+/************************************************************************/
+/* Configure the UART registers (also needed after PRR gated the USART) */
+/************************************************************************/
+void uart_config(void){
 	//Configure UART(U) Baud Rate Register (BRR) #0 (0) high and low (H/L)
-	UBRR0H = (BAUD_FREQ>>8); // Right-shift our baud rate into the high (H) section of the register
-	UBRR0L = BAUD_FREQ; // Set the low (L) section of the register to our baud rate
+	unsigned int ubrr = (clk_speed == CLK_SLOW) ? BAUD_FREQ_SLOW : BAUD_FREQ;
+	UBRR0H = (ubrr>>8); // Right-shift our baud rate into the high (H) section of the register
+	UBRR0L = ubrr; // Set the low (L) section of the register to our baud rate
+	UCSR0A |= (1<<U2X0); // Double speed mode keeps the baud error at 0.16% on both clocks
 
 	//Configure UART (U) Control + Status Registers (CSR) #0 (0) B and C (B/C) 
 	UCSR0B |= (1<<TXEN0)  | (1<<RXEN0); // Enable transmit (TX) on PD1 (pin 15) and receive (RX) on PD0 (pin 14)
 	UCSR0C |= (1<<UCSZ00) | (1<<UCSZ01); // Initialize to use 8-bit bytes on RX+TX
-	sei();
+	PORTD |= (1<<PD0); // pull-up on RXD: an unconnected line reads idle instead of waking us or receiving garbage
+}
+
+/************************************************************************/
+/* Resynchronize the receiver after a power-down wake: the start bit that
+ * woke us arrived while the oscillator was stopped, so that char (and any
+ * that followed during start-up) is incomplete. Wait until RXD has idled
+ * high for longer than one char (at most 50ms), then flush the receive buffer.
+ *	The oscillator itself restarts in 6 CK, so this quiet window (at least
+ *	3ms) is most of the time from the wake edge to our first reply byte.
+ *	Text mode: the wake char only wakes us (as with "Hit enter to wake").
+ *	Binary mode: the client resends its frame after BIN_ST_WAKE.
+ */
+/************************************************************************/
+void uart_resync(void){
+	int quiet = 0, waited = 0;
+	while(quiet < 3 && waited < 50){ // one char at 4800 baud takes ~2.1ms, give up on a line held low
+		delay_ms(1);
+		waited++;
+		if(PIND & (1<<PD0)) quiet++;
+		else quiet = 0;
+	}
+	while(UCSR0A & (1<<RXC0)) (void)UDR0; // drop anything the USART picked up mid-char
+}
+
+/************************************************************************/
+/* Text mode: drop the rest of the line whose first key woke us (as the
+ * IDLE path's scanUART did), so "WDSA" typed to wake is not scored as "DSA".
+ *	Stops at CR/LF, after 300ms without RX, or after 2s at most
+ */
+/************************************************************************/
+void uart_drop_line(void){
+	int quiet = 0, waited = 0;
+	while(quiet < 300 && waited < 2000){
+		waited++;
+		if(UCSR0A & (1<<RXC0)){
+			char c = UDR0;
+			if(c == '\n' || c == '\r') break;
+			quiet = 0;
+		}
+		else{
+			delay_ms(1);
+			quiet++;
+		}
+	}
 }
 
 /************************************************************************/
@@ -305,6 +755,8 @@ void uart_init(){
 /************************************************************************/
 void uart_tx(char data){
 	while(! (UCSR0A & (1<<UDRE0)) ); // Wait for previous transmission to finish
+	UCSR0A = (UCSR0A & (1<<U2X0)) | (1<<TXC0); // clear Transmit Complete (written as 1) so clk_set can wait on it
+	uart_txbusy = 1;
 	UDR0 = data;
 }
 
@@ -322,9 +774,23 @@ char uart_rx(){
  */
 /************************************************************************/
 void scanUART(char* buffer, int max_len) {
-	int i;
+	int i, presses = 0;
+	clk_set(CLK_SLOW); // nothing to do but wait for the player
+	btn_flush(); // presses made before this read (playback, binary mode, a finished game) are stale
 	for(i=0; i<max_len; i++) {
-		buffer[i] = uart_rx();	// receive next byte
+		if(input_rx(&buffer[i])){ // a button press, as its choice's key
+			if(ingame == 0){ // no terminal needed: any button starts a game
+				strcpy(buffer, "start");
+				i = 5;
+				break;
+			}
+			uart_tx(buffer[i]);		// echo back byte
+			if(++presses >= simonat+1){ // the whole sequence was pressed, no enter needed
+				i++;
+				break;
+			}
+			continue;
+		}
 		uart_tx(buffer[i]);		// echo back byte
 		if(buffer[i] == '\n' || buffer[i] == '\r') break;	// stop receiving if user pressed enter
 	}
@@ -390,65 +856,383 @@ void nlClrPrint(char* orig, char color){
 }
 
 void led_test(){
-	int i;
-	for(i=0; i < 5; i++)
+	int i, j;
+	for(i=0; i < 5; i++) // chase forward
 	{
-		led_on('a');
-		_delay_ms(80);
-		led_off('a');
-		
-		led_on('b');
-		_delay_ms(80);
-		led_off('b');
-		
-		led_on('c');
-		_delay_ms(100);
-		led_off('c');
-		
-		led_on('d');
-		_delay_ms(80);
-		led_off('d');	
-	}	
+		for(j=0; j < NUM_CHOICES; j++){
+			led_show(choice_masks[j]);
+			delay_ms(80);
+		}
+	}
 	
-	for(i=0; i < 5; i++)
+	for(i=0; i < 5; i++) // chase backward
 	{		
-		led_on('d');
-		_delay_ms(80);
-		led_off('d');
-		
-		led_on('c');
-		_delay_ms(80);
-		led_off('c');
-		
-		led_on('b');
-		_delay_ms(80);
-		led_off('b');
-		
-		led_on('a');
-		_delay_ms(80);
-		led_off('a');
+		for(j=NUM_CHOICES-1; j >= 0; j--){
+			led_show(choice_masks[j]);
+			delay_ms(80);
+		}
 	}
-	for(i=0; i < 5; i++)
+	for(i=0; i < 5; i++) // blink all at once
 	{
-	led_on('a');
-	led_on('b');
-	led_on('c');
-	led_on('d');
-	_delay_ms(60);
-	led_off('a');
-	led_off('b');
-	led_off('c');
-	led_off('d');
-	_delay_ms(60);
+		led_show(LED_ALL);
+		delay_ms(60);
+		led_show(0);
+		delay_ms(60);
 	}	
 }
 
 void init_pins(){
 	ADMUX = (1<<REFS0); //init ADMUX (use internal)
-	set_out(DDRA,PINA1);
-	set_out(DDRA,PINA2);
-	set_out(DDRA,PINA3);
-	set_out(DDRA,PINA4);
+	LED_DDR |= LED_ALL; // every choice's LED is an output
+}
+
+/************************************************************************/
+/* Clear the game state (shared by the text and binary front-ends)      */
+/************************************************************************/
+void game_reset(void){
+	hs_submit(score); // keep the score if it made the table
+	score = 0; // reset the score
+	ingame = 0; // reset the state
+	playerturn = 0; // the next game starts on Simon's turn
+	memset(simonsaid, 0, sizeof(simonsaid)); // clear Simon's string
+	simonsays = '\0'; // clear Simon's last char
+	simonat = -1; // reset Simon's string position (must be -1)
+}
+
+/************************************************************************/
+/* Simon picks a new choice and appends it to his sequence.
+ *	Returns the new choice index (0 to NUM_CHOICES-1)
+ */
+/************************************************************************/
+int game_extend(void){
+	/*!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!
+	This has a strong bias towards the lower end of RAND_MAX for some reason
+	and needs to be replaced with a different PRNG (or modded with heuristics)
+	  !!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!*/
+	clk_set(CLK_FAST); // two ADC conversions and rand() are CPU-bound
+	rnd = my_rand(); // get a pseudo-random number
+	clk_set(CLK_SLOW); // the playback that follows waits on the UART
+	simonsays = choice_keys[rnd-1];
+	simonled = rnd-1;
+	
+	// increment our simonat (current) position
+	// and then add the new random char at that position
+	// simonat must initialize at -1
+	simonledseq[simonat+1] = simonled;
+	simonsaid[++simonat] = simonsays;
+	return rnd-1;
+}
+
+/************************************************************************/
+/* Compare the player's answer with Simon's sequence.
+ *	Returns GAME_MISS, GAME_MATCH or GAME_WON (score is incremented on a match)
+ */
+/************************************************************************/
+int game_check(char* answer){
+	if(strncasecmp(answer,simonsaid,strlen(simonsaid)) != 0) return GAME_MISS;
+	score ++; // increment the score
+	if(simonat+1 >= SIMON_MAX) return GAME_WON; // win condition
+	return GAME_MATCH;
+}
+
+/************************************************************************/
+/* Checkpoint the game into the .noinit snapshot (survives resets)      */
+/************************************************************************/
+void snap_save(void){
+	unsigned char i, crc = 0;
+	snap.magic = 0; // a reset during the copy leaves an invalid snapshot
+	memcpy(snap.simonsaid, simonsaid, sizeof(simonsaid));
+	memcpy(snap.simonledseq, simonledseq, sizeof(simonledseq));
+	snap.simonat = simonat;
+	snap.score = score;
+	snap.ingame = ingame;
+	snap.playerturn = playerturn;
+	snap.binmode = binmode;
+	snap.magic = SNAP_MAGIC;
+	for(i=0; i<offsetof(snapshot, crc); i++) crc = _crc8_ccitt_update(crc, ((unsigned char*)&snap)[i]);
+	snap.crc = crc;
+}
+
+/************************************************************************/
+/* Restore the game from the snapshot on a warm start.
+ *	Returns 1 if the last reset came from the watchdog or a brown-out and
+ *	the snapshot is intact, 0 for a cold start (the caller initializes everything)
+ */
+/************************************************************************/
+int snap_restore(void){
+	unsigned char i, crc = 0;
+	if(! (mcusr_mirror & ((1<<WDRF)|(1<<BORF))) ) return 0; // power-on or external reset
+	if(mcusr_mirror & (1<<PORF)) return 0; // BORF can come with PORF at power-up, SRAM is random then
+	if(snap.magic != SNAP_MAGIC) return 0;
+	for(i=0; i<offsetof(snapshot, crc); i++) crc = _crc8_ccitt_update(crc, ((unsigned char*)&snap)[i]);
+	if(crc != snap.crc) return 0;
+	if(snap.simonat < -1 || snap.simonat > SIMON_MAX-1) return 0; // game_extend would write past simonsaid
+	if(snap.ingame > 1 || snap.playerturn > 1 || snap.binmode > 1) return 0;
+	
+	memcpy(simonsaid, snap.simonsaid, sizeof(simonsaid));
+	memcpy(simonledseq, snap.simonledseq, sizeof(simonledseq));
+	simonsaid[SIMON_MAX] = '\0';
+	simonat = snap.simonat;
+	score = snap.score;
+	ingame = snap.ingame;
+	playerturn = snap.playerturn;
+	binmode = snap.binmode;
+	return 1;
+}
+
+/************************************************************************/
+/* High-Score Table
+ *	The table lives in an SRAM cache (hs_cache). Each change is written to
+ *	the next of HS_SLOTS EEPROM slots, so every slot wears HS_SLOTS times
+ *	slower, and the newest slot with a valid CRC is loaded at boot.
+ *	Writes go byte by byte from the EE_READY interrupt, so the ~3.4ms per
+ *	byte EEPROM write time never stalls the game.
+ */
+/************************************************************************/
+
+/************************************************************************/
+/* CRC-8 over the generation and scores of a table copy                 */
+/************************************************************************/
+unsigned char hs_crc(volatile hs_record* rec){
+	unsigned char crc = _crc8_ccitt_update(0, rec->gen);
+	unsigned char i;
+	for(i=0; i<HS_COUNT; i++) crc = _crc8_ccitt_update(crc, rec->scores[i]);
+	return crc;
+}
+
+/************************************************************************/
+/* Fill hs_cache from the newest valid EEPROM slot (an empty table if none) */
+/************************************************************************/
+void hs_load(void){
+	hs_record rec;
+	unsigned char i, found = 0;
+	memset(&hs_cache, 0, sizeof(hs_cache));
+	hs_slot = HS_SLOTS-1; // the first write goes to slot 0
+	for(i=0; i<HS_SLOTS; i++){
+		eeprom_read_block(&rec, &hs_eeprom[i], sizeof(rec));
+		if(rec.crc != hs_crc(&rec)) continue; // torn or never written
+		if(found == 0 || (signed char)(rec.gen - hs_cache.gen) > 0){ // newer (gen wraps at 256)
+			hs_cache = rec;
+			hs_slot = i;
+			found = 1;
+		}
+	}
+}
+
+/************************************************************************/
+/* Copy hs_cache into hs_pending and start writing it to the next slot.
+ *	Called with interrupts disabled
+ */
+/************************************************************************/
+void hs_start_write(void){
+	unsigned char i;
+	hs_pending.gen = hs_cache.gen;
+	for(i=0; i<HS_COUNT; i++) hs_pending.scores[i] = hs_cache.scores[i];
+	hs_pending.crc = hs_crc(&hs_pending);
+	hs_slot = (hs_slot+1) % HS_SLOTS;
+	hs_wpos = 0;
+	hs_dirty = 0;
+	EECR |= (1<<EERIE); // EE_READY fires as soon as the EEPROM is free
+}
+
+/************************************************************************/
+/* Write the next byte of hs_pending (EEPROM must be ready).
+ *	Disables the EE_READY interrupt once nothing is left to write
+ */
+/************************************************************************/
+void hs_write_step(void){
+	if(hs_wpos < sizeof(hs_record)){
+		EEAR = (unsigned int)&hs_eeprom[hs_slot] + hs_wpos;
+		EEDR = ((volatile unsigned char*)&hs_pending)[hs_wpos++];
+		EECR |= (1<<EEMPE); // EEPE must be set within 4 cycles of EEMPE
+		EECR |= (1<<EEPE); // start the erase+write
+	}
+	else if(hs_dirty){
+		hs_start_write(); // the table changed meanwhile, write the newer copy
+	}
+	else{
+		EECR &= ~(1<<EERIE); // all written
+	}
+}
+
+/************************************************************************/
+/* Interrupt fired while the EEPROM is ready for the next byte          */
+/************************************************************************/
+ISR(EE_READY_vect){
+	hs_write_step();
+}
+
+/************************************************************************/
+/* Enter a finished game's score into the table (if it made the table)  */
+/************************************************************************/
+void hs_submit(int new_score){
+	int i;
+	unsigned char sreg;
+	if(new_score <= hs_cache.scores[HS_COUNT-1]) return;
+	for(i = HS_COUNT-1; i > 0 && hs_cache.scores[i-1] < new_score; i--){
+		hs_cache.scores[i] = hs_cache.scores[i-1]; // shift lower scores down
+	}
+	hs_cache.scores[i] = new_score;
+	hs_cache.gen++;
+	
+	sreg = SREG;
+	cli();
+	if(hs_wpos < sizeof(hs_record)) hs_dirty = 1; // picked up when the current write ends
+	else hs_start_write();
+	SREG = sreg; // restore the interrupt flag (may be called with interrupts off)
+}
+
+/************************************************************************/
+/* Finish any queued EEPROM writes by polling (works with interrupts off) */
+/************************************************************************/
+void hs_flush(void){
+	unsigned char sreg = SREG;
+	cli();
+	while(EECR & (1<<EERIE)){
+		while(EECR & (1<<EEPE)); // wait for the current byte
+		hs_write_step();
+	}
+	SREG = sreg;
+}
+
+/************************************************************************/
+/* Binary Protocol Mode
+ *	Entered with the "binary" command, left with a BIN_CMD_TEXT frame.
+ *	Every message is one frame: BIN_SYNC, type, len, payload[len], crc
+ *	where crc is CRC-8/CCITT over type, len and payload. A round costs
+ *	SEQ (6) + ANSWER (4+n) + SCORE (5) = 15+n bytes with no playback delays.
+ *
+ *	At 4800 baud (480 bytes/s), for a round of n symbols:
+ *	  n    text bytes  text rounds/s   binary bytes  binary rounds/s
+ *	  1       139         0.84             16            30.0
+ *	  10      346         0.10             25            19.2
+ *	  30      806         0.035            45            10.7
+ *	A full 30-round game costs 14175 bytes in text mode and 915 in binary.
+ *	Text mode is dominated by the 0.9s per symbol playback animation.
+ */
+/************************************************************************/
+
+/************************************************************************/
+/* Send one binary frame                                                */
+/************************************************************************/
+void bin_tx(unsigned char type, unsigned char* payload, unsigned char len){
+	unsigned char crc = _crc8_ccitt_update(_crc8_ccitt_update(0, type), len);
+	unsigned char i;
+	uart_tx(BIN_SYNC);
+	uart_tx(type);
+	uart_tx(len);
+	for(i=0; i<len; i++){
+		uart_tx(payload[i]);
+		crc = _crc8_ccitt_update(crc, payload[i]);
+	}
+	uart_tx(crc);
+}
+
+/************************************************************************/
+/* Send a BIN_EVT_STATE frame                                           */
+/************************************************************************/
+void bin_state(unsigned char state){
+	bin_tx(BIN_EVT_STATE, &state, 1);
+}
+
+/************************************************************************/
+/* Receive one binary frame. Bytes are skipped until BIN_SYNC so that the
+ * stream resynchronizes after garbage. Returns the payload length, or -1
+ * if the frame is too long or its CRC does not match
+ */
+/************************************************************************/
+int bin_rx(unsigned char* type, unsigned char* payload){
+	unsigned char len, crc, i;
+	clk_set(CLK_SLOW); // nothing to do but wait for the client
+	while((unsigned char)uart_rx() != BIN_SYNC); // hunt for the start of a frame
+	*type = uart_rx();
+	len = uart_rx();
+	my_wdt_reset();
+	if(len > BIN_MAX_PAYLOAD) return -1;
+	crc = _crc8_ccitt_update(_crc8_ccitt_update(0, *type), len);
+	for(i=0; i<len; i++){
+		payload[i] = uart_rx();
+		crc = _crc8_ccitt_update(crc, payload[i]);
+	}
+	if((unsigned char)uart_rx() != crc) return -1;
+	return len;
+}
+
+/************************************************************************/
+/* Play Simon-Says over binary frames until the client sends BIN_CMD_TEXT */
+/************************************************************************/
+void bin_loop(void){
+	unsigned char type;
+	unsigned char payload[BIN_MAX_PAYLOAD];
+	unsigned char out[2];
+	int len, i;
+	
+	while(binmode == 1){
+		snap_save();
+		if(ingame == 1 && playerturn == 0){ // Simon's turn: only the newest symbol is sent
+			out[1] = game_extend();
+			out[0] = simonat+1; // round number (sequence length)
+			bin_tx(BIN_EVT_SEQ, out, 2);
+			playerturn = 1;
+			continue;
+		}
+		
+		len = bin_rx(&type, payload);
+		if(len < 0){
+			bin_state(BIN_ST_BADFRAME);
+			continue;
+		}
+		switch(type){
+			case BIN_CMD_START :
+				if(ingame == 1){
+					bin_state(BIN_ST_BUSY); // finish or quit the current game first
+					break;
+				}
+				game_reset();
+				ingame = 1;
+				break;
+			case BIN_CMD_ANSWER :
+				if(ingame == 0 || playerturn == 0){
+					bin_state(BIN_ST_READY);
+					break;
+				}
+				for(i=0; i<len; i++){ // unknown indices can never match Simon
+					input[i] = (payload[i] < NUM_CHOICES) ? choice_keys[payload[i]] : '?';
+				}
+				input[len] = '\0';
+				i = game_check(input);
+				out[0] = score;
+				bin_tx(BIN_EVT_SCORE, out, 1);
+				if(i == GAME_MISS){
+					bin_state(BIN_ST_LOST);
+					game_reset();
+				}
+				else if(i == GAME_WON){
+					bin_state(BIN_ST_WON);
+					game_reset();
+				}
+				playerturn = 0;
+				break;
+			case BIN_CMD_QUIT :
+				game_reset();
+				bin_state(BIN_ST_QUIT);
+				break;
+			case BIN_CMD_SCORES :
+				bin_tx(BIN_EVT_SCORES, hs_cache.scores, HS_COUNT);
+				break;
+			case BIN_CMD_SEQ :
+				bin_tx(BIN_EVT_FULLSEQ, (unsigned char*)simonledseq, simonat+1);
+				break;
+			case BIN_CMD_TEXT :
+				bin_state(BIN_ST_TEXT);
+				binmode = 0;
+				break;
+			default :
+				bin_state(BIN_ST_BADFRAME);
+				break;
+		}
+	}
+	input[0] = '\0';
 }
 
 /************************************************************************/
@@ -456,26 +1240,56 @@ void init_pins(){
 /************************************************************************/
 int main(void){
 	if(runonce == 0){ // run on initialization only
-		_delay_ms(1000); // delay main by 1s (better solution is to wait for connect)
+		int warm = snap_restore(); // resume after a watchdog or brown-out reset
+		clk_set(CLK_SLOW); // take over the CLKDIV8 fuse setting
+		if(warm == 0){
+			delay_ms(1000); // delay main by 1s (better solution is to wait for connect)
+		}
 		init_pins();		
-		led_test();
+		PRR = PRR_AWAKE; // gate the modules Simon never uses
+		btn_init();
+		if(warm == 0){
+			led_test();
+		}
 		uart_init();		
+		hs_load();
 		wdt_init();
 		
-		nlClrPrint("/r/nWelcome to A Game of Simon-Says!",'p');
-		nlClrPrint("Type Help for a list of all commands.",'y');
-		nlClrPrint("Type Start to begin...",'g');		
+		if(warm == 0){
+			nlClrPrint("/r/nWelcome to A Game of Simon-Says!",'p');
+			nlClrPrint("Type Help for a list of all commands.",'y');
+			nlClrPrint("Type Start to begin...",'g');		
+		}
+		else if(binmode == 1){
+			bin_state(BIN_ST_RESUMED);
+		}
+		else{
+			nlClrPrint("Simon-Says resumed after a reset.",'p');
+			if(ingame == 1){
+				nlClrPrint("Your game has resumed",'G');
+				if(playerturn == 1) nlPrint("Its your turn! What did Simon say?");
+			}
+		}
 		runonce = 1;
 	}
 	else if(sleeping == 1){ // sleeping-end feedback
-		nlClrPrint("Sleep-Cycle Ended: Welcome back to Simon-Says!",'p');
 		sleeping = 0; // unset sleep flag
-		if(ingame == 1){
-			nlClrPrint("Your game has resumed",'G');
+		if(binmode == 1){
+			bin_state(BIN_ST_WAKE); // the client resends the frame that woke us
 		}
-	}	
+		else{
+			nlClrPrint("Sleep-Cycle Ended: Welcome back to Simon-Says!",'p');
+			if(ingame == 1){
+				nlClrPrint("Your game has resumed",'G');
+			}
+		}
+	}
+	if(binmode == 1){ // resume binary mode after a sleep-cycle
+		bin_loop();
+	}
 				
 	while(1){		
+		snap_save(); // checkpoint before each wait for input
 		if(ingame == 0){ // if a game hasn't been started yet
 			scanUART(input, 50);  //read a line up to 50 chars
 		}
@@ -486,11 +1300,7 @@ int main(void){
 		else if(quitting == 1){ // if quitting flag is 1
 			if(strcasecmp(input, "yes") == 0){ // if player confirms quit
 				nlClrPrint("You've quit. Game resetting!",'y'); // quitting feedback
-				score = 0; // clear the score
-				ingame = 0; // clear the state
-				strcpy(simonsaid,""); // clear Simon's string
-				simonsays = 0; // clear Simon's last char
-				simonat = -1; // reset Simon's string position (must be -1)
+				game_reset(); // clear the score and state
 			}
 			else if(strcasecmp(input, "no") == 0){ //if player cancels quit
 				nlClrPrint("Not Quitting.",'g'); // not quitting feedback
@@ -515,6 +1325,7 @@ int main(void){
 			nlPrint("	list of symbols, in order, each round.");
 			nlPrint("	If the player fails, they are eliminated.");
 			nlPrint("	If the player can recreate a list of 30 symbols, they win!");
+			nlPrint("	The buttons work too: any button starts a game.");
 			nlPrint("	------------------------------------	");
 			nlPrint("											");
 			printf(KYEL "");
@@ -523,6 +1334,8 @@ int main(void){
 			nlPrint("	Help - displays this help text");
 			nlPrint("	Quit - exits the game completely after a confirmation");
 			nlPrint("	Start - begins a new game with Simon, if one is not in progress");
+			nlPrint("	Scores - displays the high-score table");
+			nlPrint("	Binary - switches to the compact binary protocol (for automated clients)");
 			nlPrint("	------------------------------------	");
 			printf(KNRM "");
 			continue;
@@ -530,48 +1343,19 @@ int main(void){
 		
 		if(ingame == 1){ // if a game is in session
 			if(playerturn == 0){ // its Simon's turn				
-				/*!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!
-				This has a strong bias towards the lower end of RAND_MAX for some reason
-				and needs to be replaced with a different PRNG (or modded with heuristics)
-				  !!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!!*/
-				rnd = my_rand(); // get a pseudo-random number
-					
-				switch (rnd){
-					case 1:
-						simonsays = A;
-						simonled = 'a';					
-						break;
-					case 2:
-						simonsays = B;
-						simonled = 'b';	
-						break;
-					case 3:
-						simonsays = C;
-						simonled = 'c';	
-						break;
-					case 4 :
-						simonsays = D;
-						simonled = 'd';	
-						break;					
-				}
-				
-			// increment our simonat (current) position
-			// and then add the new random char at that position
-			// simonat must initialize at -1
-			simonledseq[simonat+1] = simonled;
-			simonsaid[++simonat] = simonsays;
+				game_extend(); // Simon adds a new random char to his string
 			
 			// Simon generates his random output here
 				printf("Simon Says: "); // output feedback
 				int i;
 				for(i = 0; i < simonat+1; i++){
 					printf(KGRN "?"); // print green ? placeholder
-					_delay_ms(450); // hold for .4s
+					delay_ms(450); // hold for .4s
 					printf("\b"); // backspace placeholder
-					printf(KYEL"%c",simonsaid[i]); // print yellow Simon character
-					led_on(simonledseq[i]);
-					_delay_ms(450); // hold for .4s
-					led_off(simonledseq[i]);
+					printf("%s%c",choice_colors[(int)simonledseq[i]],simonsaid[i]); // print Simon character in its color
+					led_show(choice_masks[(int)simonledseq[i]]);
+					delay_ms(450); // hold for .4s
+					led_show(0);
 					printf(KNRM"\b "); // remove Simon character
 				}
 				nlPrint(""); // give us a newline
@@ -583,35 +1367,26 @@ int main(void){
 				scanUART(input, 50);  //read a line from UART up to 50 chars
 				
 				if(strcasecmp(input,"quit") == 0){
-					score = 0; // reset the score
-					ingame = 0; // reset the state
-					memset(simonsaid, 0, strlen(simonsaid)); // clear Simon's string
-					simonsays = '\0'; // clear Simon's last char
-					simonat = -1; // reset Simon's string position
+					game_reset(); // reset the score and state
 					nlPrint("Game over: You quit!");
-				}				
-				else if(strncasecmp(input,simonsaid,strlen(simonsaid)) == 0){ // the Player's input matched Simon!
-					score ++; // increment the score
-					printf("Simon:%s You:%s\r\n",input,simonsaid);
-					nlPrint("That matched! Great Job. Get ready to go again...");
-					
-					if(simonat >= strlen(simonsaid)){ // win condition
-						nlPrint("That matched! Simon gives up! YOU WON!"); // win feedback
-						score = 0; // reset the score
-						ingame = 0; // reset the state
-						memset(simonsaid, 0, strlen(simonsaid)); // clear Simon's string
-						simonsays = '\0'; // clear Simon's last char
-						simonat = -1; // reset Simon's string position						
-					}
 				}
-				else{ // failure condition
-					nlClrPrint("That didn't match. YOU LOST! Your final score was: ",'y');
-					printf("%d\r\n",score);
-					score = 0; // reset the score
-					ingame = 0; // reset the state
-					memset(simonsaid, 0, strlen(simonsaid)); // clear Simon's string
-					simonsays = '\0'; // clear Simon's last char
-					simonat = -1; // reset Simon's string position
+				else{
+					switch(game_check(input)){
+						case GAME_MATCH : // the Player's input matched Simon!
+							printf("Simon:%s You:%s\r\n",input,simonsaid);
+							nlPrint("That matched! Great Job. Get ready to go again...");
+							break;
+						case GAME_WON : // win condition
+							printf("Simon:%s You:%s\r\n",input,simonsaid);
+							nlPrint("That matched! Simon gives up! YOU WON!"); // win feedback
+							game_reset();
+							break;
+						default : // failure condition
+							nlClrPrint("That didn't match. YOU LOST! Your final score was: ",'y');
+							printf("%d\r\n",score);
+							game_reset();
+							break;
+					}
 				}
 				playerturn = 0; // set the turn to: Simon's turn
 			}
@@ -620,6 +1395,20 @@ int main(void){
 			nlPrint("Game starting!"); // start init feedback
 			ingame = 1;	// set ingame flag true
 		}
+		else if(strcasecmp(input,"scores") == 0){ // if player typed scores
+			int i;
+			nlClrPrint("	-:[ HIGH SCORES ]:-	",'p');
+			for(i = 0; i < HS_COUNT; i++){
+				printf("	%d. %d\r\n", i+1, hs_cache.scores[i]);
+			}
+		}
+		else if(strcasecmp(input,"binary") == 0){ // if player typed binary
+			nlClrPrint("Entering binary protocol mode.",'y');
+			binmode = 1;
+			bin_state(BIN_ST_READY);
+			bin_loop(); // returns once the client sends BIN_CMD_TEXT
+			nlClrPrint("Back in text mode.",'y');
+		}
 		else { // input echo
 			sprintf(output,"You typed in '%s'", input);
 			nlPrint(output);